@@ -1,27 +1,85 @@
 // Producer–Consumer with statistics (Problem 1) + batch mode + sample output file.
 // Build: gcc -O2 -Wall -Wextra -pthread src/PRODCONS.c -o bin/PRODCONS -pthread
-// Single run:   ./bin/PRODCONS <producers> <consumers> <buffer> [--fast]
-// All 18 runs:  ./bin/PRODCONS --all [--fast] [--outfile sample_output.txt]
+// Single run:   ./bin/PRODCONS <producers> <consumers> <buffer> [--fast] [--placement <policy>] [--numa-local] [--spin <n>] [--autoscale <min>]
+// All 18 runs:  ./bin/PRODCONS --all [--fast] [--outfile sample_output.txt] [--placement <policy>] [--numa-local] [--spin <n>] [--autoscale <min>]
 //
 // Notes:
 // - Default behavior follows spec: producers sleep 5–40 ms per item.
 // - Use --fast (or env FAST_MODE=1) to disable sleeps for quick testing.
 // - --all writes a complete sample output file (default: sample_output.txt).
+// - --placement pins threads: none (default), compact, scatter, pair.
+// - --numa-local first-touches the ring and per-consumer stats on the node that uses them.
+// - --spin caps the busy-wait iterations before a blocked thread parks in the kernel.
+// - --autoscale keeps between <min> and C consumers active based on queue depth and latency.
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <pthread.h>
-#include <semaphore.h>
 #include <stdatomic.h>
 #include <unistd.h>
 #include <time.h>
 #include <string.h>
 #include <errno.h>
+#include <sched.h>
+#include <dirent.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
 
 #define TARGET_ITEMS        1000
 #define PRODUCE_MIN_US      5000      // 5 ms (spec)
 #define PRODUCE_MAX_US      40000     // 40 ms (spec)
+#define CACHE_LINE          64
+#define SYSFS_CPU           "/sys/devices/system/cpu"
+#define SPIN_DEFAULT        200       // busy-wait iterations before parking (multi-CPU hosts)
+#define HSEM_CLOSED         (1 << 30) // count bit set once a semaphore is closed
+#define SCALE_TICK_US       1000      // occupancy sample period
+#define SCALE_WINDOW        5         // samples per scaling decision
+#define SCALE_OCC_HIGH      0.75      // grow at or above this mean occupancy
+#define SCALE_OCC_LOW       0.25      // shrink at or below this mean occupancy...
+#define SCALE_LAT_HIGH_US   2000.0    // ...or grow when items wait this long
+#define SCALE_LAT_LOW_US    200.0     // ...and only shrink while waits stay this short
+
+typedef enum {
+    PLACE_NONE = 0, // leave threads to the scheduler
+    PLACE_COMPACT,  // fill siblings, then cores, then sockets
+    PLACE_SCATTER,  // spread across sockets, then physical cores, then siblings
+    PLACE_PAIR      // producer i and consumer i on sibling CPUs of one core
+} Placement;
+
+static const char *placement_name[] = {"none","compact","scatter","pair"};
+
+typedef struct {
+    int fast_mode;
+    Placement placement;
+    int numa_local;
+    int spin_max;     // -1 = pick from CPU count
+    int scale_min;    // 0 = fixed pool; else minimum active consumers
+} RunOptions;
+
+// Counting semaphore that spins briefly before parking on a futex.
+// The count word doubles as the futex word; closing sets HSEM_CLOSED in it,
+// so a close can never slip between a waiter's check and its sleep.
+typedef struct {
+    atomic_int count;     // tokens | HSEM_CLOSED
+    atomic_int waiters;   // threads parked (or about to park) on count
+    // Metrics. Only wakeups is written per operation (and only on the slow
+    // path); the rest are merged from each thread's WaitLocal at exit.
+    _Alignas(CACHE_LINE) atomic_long wakeups; // threads woken by posts
+    atomic_long fast;                         // waits satisfied without sleeping
+    atomic_long slow;                         // waits that slept at least once
+    atomic_long spins;                        // pause iterations spent waiting
+    atomic_long parks;                        // futex sleeps
+} HybridSem;
+
+// One thread's view of a HybridSem: its adaptive spin budget and metrics.
+typedef struct {
+    int  budget;
+    long fast, slow, spins, parks;
+} WaitLocal;
 
 typedef struct {
     uint8_t day;   // 1–30
@@ -32,27 +90,77 @@ typedef struct {
     double  amount; // 0.50..999.99
 } Sale;
 
+typedef struct {
+    int cpu;       // logical CPU id
+    int package;   // physical socket
+    int core;      // core id within the socket
+    int node;      // NUMA node
+    int smt_rank;  // position among hyperthread siblings of its core
+    int core_rank; // position of its core within the socket
+} CpuInfo;
+
+typedef struct {
+    CpuInfo *cpus;     // allowed CPUs, sorted by (package, core, cpu)
+    int     *scatter;  // indices into cpus, scatter order
+    int n;
+    int packages;
+    int nodes;         // highest NUMA node id + 1
+} Topology;
+
+typedef struct {
+    int cid, P;
+    double *store_totals;     // size P
+    double  month_totals[12];
+    double  aggregate;
+    long    items;            // records consumed
+    long    parks;            // times deactivated by the autoscaler
+} __attribute__((aligned(CACHE_LINE))) LocalStats;
+
+// Ring slot: the enqueue time travels with the record, on the same line.
+typedef struct {
+    Sale     sale;
+    uint64_t enq_ns;          // set only under --autoscale, else 0
+} Slot;
+
 typedef struct {
     // Circular buffer
-    Sale *buf;
+    Slot *buf;
     int capacity;
     int head, tail;
 
     // Sync
-    sem_t empty, full;
+    HybridSem empty, full;
     pthread_mutex_t qmtx;
 
     // Counters/state
+    atomic_int reserved_total;   // production tickets handed out
     atomic_int produced_total;
     atomic_int consumed_total;
-    atomic_int done;
     int P, C, B;
+    int spin_max;
 
     // Output for this run
     FILE *out;
 
     // Fast mode?
     int fast_mode;
+
+    // Placement
+    Placement placement;
+    int numa_local;
+    LocalStats **locals;      // size C; allocated by consumers when numa_local
+    int *prod_cpu, *cons_cpu; // CPU each thread last ran on (-1 if unknown)
+    int pinned, pin_failed;
+    atomic_int alloc_failed;  // a consumer could not allocate its own stats
+
+    // Autoscaling: consumers with cid >= active park on the active word
+    int scale_min;                 // 0 = disabled; C is the pool maximum
+    atomic_int active;
+    atomic_int scale_stop;
+    atomic_llong lat_ns, lat_n;    // dequeue latency totals
+    int peak_active, grows, shrinks;
+    double occ_sum;                // sum of occupancy samples
+    long occ_samples;
 } Shared;
 
 typedef struct {
@@ -63,29 +171,297 @@ typedef struct {
     FILE *out;
 } GlobalStats;
 
-typedef struct {
-    int cid, P;
-    double *store_totals;     // size P
-    double  month_totals[12];
-    double  aggregate;
-} LocalStats;
-
 // -------------------- Globals (reset per run) --------------------
 static Shared G;
 static GlobalStats GSTATS;
+static Topology TOPO;       // loaded once in main
 
 // -------------------- Utils --------------------
 static inline int rand_range(int lo, int hi){ return lo + rand() % (hi - lo + 1); }
 static inline double rand_amount(void){ return (double)rand_range(50, 99999) / 100.0; }
 
+static inline uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// -------------------- Hybrid semaphore --------------------
+static inline void cpu_relax(void){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Returns 0 if the thread actually slept, -1 if *addr had already changed
+// (EAGAIN) or a signal interrupted the call.
+static int futex_wait(atomic_int *addr, int expected){
+    return syscall(SYS_futex, (int*)addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0) == 0 ? 0 : -1;
+}
+
+static int futex_wake(atomic_int *addr, int n){
+    long r = syscall(SYS_futex, (int*)addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+    return r > 0 ? (int)r : 0;
+}
+
+static void hsem_init(HybridSem *s, int tokens){
+    memset(s, 0, sizeof(*s));
+    atomic_store(&s->count, tokens);
+}
+
+static inline int hsem_try(HybridSem *s, int c){
+    return (c & ~HSEM_CLOSED) > 0 && atomic_compare_exchange_weak(&s->count, &c, c - 1);
+}
+
+// Take one token. Returns 0 on success, -1 once the semaphore is closed and
+// drained. w->budget is the caller's adaptive spin allowance: it grows when
+// spinning pays off and halves each time the caller has to park, but never
+// below spin_max/16 so spinning can always earn its budget back.
+static int hsem_wait(HybridSem *s, WaitLocal *w, int spin_max){
+    int floor = spin_max > 0 ? (spin_max / 16 > 0 ? spin_max / 16 : 1) : 0;
+    long spun = 0;
+    for (int i = 0; i <= w->budget; ++i){
+        int c = atomic_load_explicit(&s->count, memory_order_relaxed);
+        if (hsem_try(s, c)){
+            w->spins += spun;
+            ++w->fast;
+            if (spun && w->budget < spin_max) w->budget += w->budget / 2 + 1;
+            if (w->budget > spin_max) w->budget = spin_max;
+            return 0;
+        }
+        if (c == HSEM_CLOSED) return -1;
+        if (i < w->budget){ cpu_relax(); ++spun; }
+    }
+    w->spins += spun;
+    w->budget /= 2;
+    if (w->budget < floor) w->budget = floor;
+
+    int slept = 0;
+    for (;;){
+        int c = atomic_load(&s->count);
+        if (hsem_try(s, c)){
+            if (slept) ++w->slow; else ++w->fast;
+            return 0;
+        }
+        if (c == HSEM_CLOSED) return -1;
+        if (c & ~HSEM_CLOSED) continue;       // lost a CAS race, tokens remain
+
+        atomic_fetch_add(&s->waiters, 1);
+        if (futex_wait(&s->count, c) == 0){ ++w->parks; slept = 1; }
+        atomic_fetch_sub(&s->waiters, 1);
+    }
+}
+
+// Fold a thread's wait metrics into the semaphore once, at thread exit.
+static void hsem_merge(HybridSem *s, const WaitLocal *w){
+    atomic_fetch_add_explicit(&s->fast,  w->fast,  memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->slow,  w->slow,  memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->spins, w->spins, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->parks, w->parks, memory_order_relaxed);
+}
+
+static void hsem_post(HybridSem *s){
+    atomic_fetch_add(&s->count, 1);
+    if (atomic_load(&s->waiters) > 0){
+        int n = futex_wake(&s->count, 1);
+        if (n) atomic_fetch_add_explicit(&s->wakeups, n, memory_order_relaxed);
+    }
+}
+
+// Wake every waiter; once tokens run out, hsem_wait() returns -1.
+static void hsem_close(HybridSem *s){
+    atomic_fetch_or(&s->count, HSEM_CLOSED);
+    int n = futex_wake(&s->count, INT_MAX);
+    if (n) atomic_fetch_add_explicit(&s->wakeups, n, memory_order_relaxed);
+}
+
+// -------------------- Topology / placement --------------------
+static int read_sysfs_int(int cpu, const char *leaf, int fallback){
+    char path[256];
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/%s", cpu, leaf);
+    FILE *f = fopen(path, "r");
+    if (!f) return fallback;
+    int v;
+    if (fscanf(f, "%d", &v) != 1) v = fallback;
+    fclose(f);
+    return v;
+}
+
+static int read_cpu_node(int cpu){
+    char path[256];
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d", cpu);
+    DIR *d = opendir(path);
+    if (!d) return 0;
+    int node = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL){
+        if (strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9'){
+            node = atoi(e->d_name + 4);
+            break;
+        }
+    }
+    closedir(d);
+    return node;
+}
+
+static int cmp_compact(const void *a, const void *b){
+    const CpuInfo *x = a, *y = b;
+    if (x->package != y->package) return x->package - y->package;
+    if (x->core != y->core)       return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+static int cmp_scatter(const void *a, const void *b){
+    const CpuInfo *x = &TOPO.cpus[*(const int*)a], *y = &TOPO.cpus[*(const int*)b];
+    if (x->smt_rank != y->smt_rank)   return x->smt_rank - y->smt_rank;
+    if (x->core_rank != y->core_rank) return x->core_rank - y->core_rank;
+    if (x->package != y->package)     return x->package - y->package;
+    return x->cpu - y->cpu;
+}
+
+// Enumerate the CPUs this process may run on into TOPO. Falls back to a
+// single flat socket when sysfs topology is unavailable.
+static int load_topology(void){
+    Topology *T = &TOPO;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0){ perror("sched_getaffinity"); return 1; }
+
+    T->n = CPU_COUNT(&set);
+    T->cpus = (CpuInfo*)calloc((size_t)T->n, sizeof(CpuInfo));
+    T->scatter = (int*)calloc((size_t)T->n, sizeof(int));
+    if (!T->cpus || !T->scatter){ perror("calloc topology"); return 1; }
+
+    int k = 0;
+    for (int c = 0; c < CPU_SETSIZE && k < T->n; ++c){
+        if (!CPU_ISSET(c, &set)) continue;
+        T->cpus[k].cpu     = c;
+        T->cpus[k].package = read_sysfs_int(c, "physical_package_id", 0);
+        T->cpus[k].core    = read_sysfs_int(c, "core_id", c);
+        T->cpus[k].node    = read_cpu_node(c);
+        ++k;
+    }
+    qsort(T->cpus, (size_t)T->n, sizeof(CpuInfo), cmp_compact);
+
+    // Ranks: siblings of one core and cores of one socket are now adjacent
+    T->packages = 0;
+    T->nodes = 1;
+    for (int i = 0; i < T->n; ++i){
+        CpuInfo *c = &T->cpus[i];
+        if (c->node >= T->nodes) T->nodes = c->node + 1;
+        if (i == 0 || c->package != T->cpus[i-1].package){
+            ++T->packages;
+            c->core_rank = 0; c->smt_rank = 0;
+        }else if (c->core != T->cpus[i-1].core){
+            c->core_rank = T->cpus[i-1].core_rank + 1; c->smt_rank = 0;
+        }else{
+            c->core_rank = T->cpus[i-1].core_rank; c->smt_rank = T->cpus[i-1].smt_rank + 1;
+        }
+        T->scatter[i] = i;
+    }
+    qsort(T->scatter, (size_t)T->n, sizeof(int), cmp_scatter);   // reads TOPO
+    return 0;
+}
+
+static void free_topology(void){
+    free(TOPO.cpus); free(TOPO.scatter);
+    memset(&TOPO, 0, sizeof(TOPO));
+}
+
+static int parse_placement(const char *s, Placement *out){
+    for (int i = 0; i < (int)(sizeof(placement_name)/sizeof(placement_name[0])); ++i)
+        if (strcmp(s, placement_name[i]) == 0){ *out = (Placement)i; return 0; }
+    return 1;
+}
+
+// Index into TOPO.cpus for a thread, or -1 when it should float.
+// Producers occupy slots 0..P-1 and consumers P..P+C-1, except under
+// PLACE_PAIR where producer i and consumer i take adjacent compact slots.
+static int placement_slot(int is_consumer, int idx){
+    if (G.placement == PLACE_NONE || TOPO.n == 0) return -1;
+    int t;
+    if (G.placement == PLACE_PAIR) t = 2*idx + (is_consumer ? 1 : 0);
+    else                           t = is_consumer ? G.P + idx : idx;
+    t %= TOPO.n;
+    return G.placement == PLACE_SCATTER ? TOPO.scatter[t] : t;
+}
+
+static const CpuInfo *cpu_info(int cpu){
+    for (int i = 0; i < TOPO.n; ++i) if (TOPO.cpus[i].cpu == cpu) return &TOPO.cpus[i];
+    return NULL;
+}
+
+static int package_of_cpu(int cpu){ const CpuInfo *c = cpu_info(cpu); return c ? c->package : -1; }
+static int node_of_cpu(int cpu)   { const CpuInfo *c = cpu_info(cpu); return c ? c->node : -1; }
+
+// Create a thread pinned according to the run's placement policy. The kernel
+// only validates the CPU at creation, so a rejected pin retries unpinned.
+static int create_placed(pthread_t *t, int is_consumer, int idx, void *(*fn)(void*)){
+    int slot = placement_slot(is_consumer, idx);
+    if (slot >= 0){
+        pthread_attr_t attr;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(TOPO.cpus[slot].cpu, &set);
+        if (pthread_attr_init(&attr) == 0){
+            int rc = pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+            if (rc == 0) rc = pthread_create(t, &attr, fn, (void*)(intptr_t)idx);
+            pthread_attr_destroy(&attr);
+            if (rc == 0){ ++G.pinned; return 0; }
+        }
+        ++G.pin_failed;
+    }
+    return pthread_create(t, NULL, fn, (void*)(intptr_t)idx);
+}
+
+static size_t page_round(size_t n){
+    size_t pg = (size_t)sysconf(_SC_PAGESIZE);
+    return n ? (n + pg - 1) / pg * pg : pg;
+}
+
+// Allocate zeroed pages straight from the kernel. They are fresh, so the
+// memset is their first touch and under the default policy they land on the
+// caller's node (the heap could hand back a page already touched elsewhere).
+static void *alloc_local(size_t n){
+    size_t sz = page_round(n);
+    void *p = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    memset(p, 0, sz);
+    return p;
+}
+
+static void free_local(void *p, size_t n){
+    if (p) munmap(p, page_round(n));
+}
+
+static LocalStats *alloc_local_stats(int cid, int P){
+    LocalStats *L = (LocalStats*)alloc_local(sizeof(LocalStats));
+    if (!L) return NULL;
+    L->cid = cid; L->P = P;
+    L->store_totals = (double*)alloc_local((size_t)P * sizeof(double));
+    if (!L->store_totals){ free_local(L, sizeof(LocalStats)); return NULL; }
+    return L;
+}
+
+static void free_local_stats(LocalStats *L){
+    if (!L) return;
+    free_local(L->store_totals, (size_t)L->P * sizeof(double));
+    free_local(L, sizeof(LocalStats));
+}
+
 // -------------------- Producer --------------------
 static void *producer(void *arg){
     int id = (int)(intptr_t)arg;          // 0..P-1
     unsigned seed = (unsigned)time(NULL) ^ (0x9e3779b9u * (unsigned)(id + 1) ^ (unsigned)pthread_self());
     srand(seed);
+    WaitLocal wait = { .budget = G.spin_max };
 
     for(;;){
-        if (atomic_load(&G.produced_total) >= TARGET_ITEMS) break;
+        // A ticket guarantees this producer an item to insert, so nobody
+        // ever waits for a slot it will not use.
+        if (atomic_fetch_add(&G.reserved_total, 1) >= TARGET_ITEMS) break;
 
         Sale s;
         s.day    = (uint8_t)rand_range(1, 30);
@@ -95,63 +471,81 @@ static void *producer(void *arg){
         s.reg    = rand_range(1, 6);
         s.amount = rand_amount();
 
-        sem_wait(&G.empty);
+        hsem_wait(&G.empty, &wait, G.spin_max);   // never closed
         pthread_mutex_lock(&G.qmtx);
 
-        if (atomic_load(&G.produced_total) >= TARGET_ITEMS){
-            pthread_mutex_unlock(&G.qmtx);
-            sem_post(&G.full);           // nudge a consumer
-            break;
-        }
-
-        G.buf[G.tail] = s;
+        G.buf[G.tail].sale = s;
+        G.buf[G.tail].enq_ns = G.scale_min ? now_ns() : 0;
         G.tail = (G.tail + 1) % G.capacity;
         atomic_fetch_add(&G.produced_total, 1);
 
         pthread_mutex_unlock(&G.qmtx);
-        sem_post(&G.full);
+        hsem_post(&G.full);
 
         if (!G.fast_mode){
             int delay = rand_range(PRODUCE_MIN_US, PRODUCE_MAX_US);
             usleep((useconds_t)delay);
         }
     }
+    hsem_merge(&G.empty, &wait);
+    G.prod_cpu[id] = sched_getcpu();
     return NULL;
 }
 
 // -------------------- Consumer --------------------
 static void *consumer(void *arg){
-    LocalStats *L = (LocalStats*)arg;
+    int id = (int)(intptr_t)arg;          // 0..C-1
+
+    // Under --numa-local the consumer allocates its own stats so they are
+    // first-touched on the node it was placed on.
+    if (!G.locals[id]) G.locals[id] = alloc_local_stats(id, G.P);
+    // On failure keep draining into a stack spill so producers never stall;
+    // the run is then reported as failed and the spill is not merged.
+    LocalStats spill = { .cid = id, .P = 0 };
+    LocalStats *L = G.locals[id];
+    if (!L){
+        perror("alloc local stats");
+        atomic_store(&G.alloc_failed, 1);
+        L = &spill;
+    }
 
+    WaitLocal wait = { .budget = G.spin_max };
     for(;;){
-        sem_wait(&G.full);
+        // Deactivated by the autoscaler: sleep until the pool grows again.
+        // A consumer already blocked on G.full finishes that item first.
+        // Grows wake every parked consumer, so count the deactivation once.
+        int a;
+        if (G.scale_min && id >= atomic_load(&G.active)) ++L->parks;
+        while (G.scale_min && id >= (a = atomic_load(&G.active)))
+            futex_wait(&G.active, a);
+
+        // -1 only after main closes G.full and the buffer is drained
+        if (hsem_wait(&G.full, &wait, G.spin_max) != 0) break;
         pthread_mutex_lock(&G.qmtx);
 
-        int produced = atomic_load(&G.produced_total);
-        int consumed = atomic_load(&G.consumed_total);
-
-        if (atomic_load(&G.done) && consumed >= produced){
-            pthread_mutex_unlock(&G.qmtx);
-            break;
-        }
-
-        if (consumed < produced){
-            Sale s = G.buf[G.head];
-            G.head = (G.head + 1) % G.capacity;
-            atomic_fetch_add(&G.consumed_total, 1);
+        Sale s = G.buf[G.head].sale;
+        uint64_t enq = G.buf[G.head].enq_ns;
+        G.head = (G.head + 1) % G.capacity;
+        atomic_fetch_add(&G.consumed_total, 1);
 
-            pthread_mutex_unlock(&G.qmtx);
-            sem_post(&G.empty);
+        pthread_mutex_unlock(&G.qmtx);
+        hsem_post(&G.empty);
 
-            // Local stats (thread-local, no lock)
-            if (s.store >= 1 && s.store <= L->P) L->store_totals[s.store - 1] += s.amount;
-            if (s.month >= 1 && s.month <= 12)   L->month_totals[s.month - 1] += s.amount;
-            L->aggregate += s.amount;
-        }else{
-            pthread_mutex_unlock(&G.qmtx);
+        if (enq){
+            atomic_fetch_add_explicit(&G.lat_ns, (long long)(now_ns() - enq), memory_order_relaxed);
+            atomic_fetch_add_explicit(&G.lat_n, 1, memory_order_relaxed);
         }
+        ++L->items;
+
+        // Local stats (thread-local, no lock)
+        if (s.store >= 1 && s.store <= L->P) L->store_totals[s.store - 1] += s.amount;
+        if (s.month >= 1 && s.month <= 12)   L->month_totals[s.month - 1] += s.amount;
+        L->aggregate += s.amount;
     }
 
+    hsem_merge(&G.full, &wait);
+    if (L == &spill) return NULL;
+
     // Merge and print local summary
     pthread_mutex_lock(&GSTATS.mtx);
 
@@ -162,6 +556,7 @@ static void *consumer(void *arg){
     if (G.out){
         fprintf(G.out, "\n--- Consumer %d summary ---\n", L->cid);
         fprintf(G.out, "Local aggregate: %.2f\n", L->aggregate);
+        if (G.scale_min) fprintf(G.out, "Items: %ld  parked: %ld\n", L->items, L->parks);
 
         int top1=-1, top2=-1;
         for (int i=0;i<L->P;++i){
@@ -174,6 +569,52 @@ static void *consumer(void *arg){
     }
 
     pthread_mutex_unlock(&GSTATS.mtx);
+    G.cons_cpu[id] = sched_getcpu();
+    return NULL;
+}
+
+// -------------------- Autoscaler --------------------
+// Samples buffer occupancy every tick and, once per window, grows the active
+// consumer set by half when the ring is backing up or items wait too long,
+// or shrinks it by one when the ring sits near empty with short waits.
+static void *scaler(void *arg){
+    (void)arg;
+    long long last_ns = 0, last_n = 0;
+    double window_occ = 0.0;
+    int ticks = 0;
+
+    while (!atomic_load(&G.scale_stop)){
+        usleep(SCALE_TICK_US);
+
+        double occ = (double)(atomic_load(&G.full.count) & ~HSEM_CLOSED) / G.capacity;
+        window_occ += occ; ++ticks;
+        G.occ_sum += occ; ++G.occ_samples;
+        if (ticks < SCALE_WINDOW) continue;
+
+        long long ns = atomic_load(&G.lat_ns), n = atomic_load(&G.lat_n);
+        double lat_us = n > last_n ? (double)(ns - last_ns) / (double)(n - last_n) / 1000.0 : 0.0;
+        double mean_occ = window_occ / ticks;
+        last_ns = ns; last_n = n;
+        window_occ = 0.0; ticks = 0;
+
+        int a = atomic_load(&G.active), next = a;
+        if ((mean_occ >= SCALE_OCC_HIGH || lat_us >= SCALE_LAT_HIGH_US) && a < G.C){
+            next = a + (a/2 > 0 ? a/2 : 1);
+            if (next > G.C) next = G.C;
+        }else if (mean_occ <= SCALE_OCC_LOW && lat_us <= SCALE_LAT_LOW_US && a > G.scale_min){
+            next = a - 1;
+        }
+        if (next == a) continue;
+
+        atomic_store(&G.active, next);
+        if (next > a){
+            ++G.grows;
+            futex_wake(&G.active, INT_MAX);
+        }else{
+            ++G.shrinks;
+        }
+        if (next > G.peak_active) G.peak_active = next;
+    }
     return NULL;
 }
 
@@ -192,27 +633,105 @@ static void print_global_tables(FILE *f, const GlobalStats *S, int P){
     fflush(f);
 }
 
+// Producer/consumer counts per domain (socket or NUMA node), by last CPU seen.
+static void print_spread(FILE *f, const char *what, char tag, int n, int (*domain_of)(int)){
+    if (n < 1) n = 1;
+    int *pc = (int*)calloc((size_t)n * 2, sizeof(int));
+    if (!pc) return;
+    int *cc = pc + n;
+    for (int i=0;i<G.P;++i){ int d = domain_of(G.prod_cpu[i]); if (d>=0 && d<n) ++pc[d]; }
+    for (int i=0;i<G.C;++i){ int d = domain_of(G.cons_cpu[i]); if (d>=0 && d<n) ++cc[d]; }
+
+    fprintf(f, "Threads per %s (producers/consumers):", what);
+    for (int d=0;d<n;++d) fprintf(f, "  %c%d=%d/%d", tag, d, pc[d], cc[d]);
+    fprintf(f, "\n");
+    free(pc);
+}
+
+// Requested placement plus where threads actually ended up.
+static void print_placement(FILE *f){
+    fprintf(f, "Placement: policy=%s  cpus=%d  sockets=%d  nodes=%d  numa_local=%s  pinned=%d  pin_failed=%d\n",
+            placement_name[G.placement], TOPO.n, TOPO.packages, TOPO.nodes,
+            G.numa_local ? "on" : "off", G.pinned, G.pin_failed);
+    print_spread(f, "socket", 's', TOPO.packages, package_of_cpu);
+    print_spread(f, "node", 'n', TOPO.nodes, node_of_cpu);
+}
+
+// Waits on G.empty are producer backpressure; waits on G.full are consumer starvation.
+static void print_wait_stats(FILE *f){
+    const struct { const char *who; const HybridSem *s; } rows[] = {
+        {"producers (empty)", &G.empty},
+        {"consumers (full) ", &G.full},
+    };
+    fprintf(f, "Wait strategy: spin<=%d then futex park\n", G.spin_max);
+    for (int i=0;i<2;++i){
+        const HybridSem *s = rows[i].s;
+        long fast = atomic_load(&s->fast), slow = atomic_load(&s->slow);
+        fprintf(f, "  %s: waits=%ld  fast=%ld  slow=%ld  spins=%ld  parks=%ld  wakeups=%ld\n", rows[i].who,
+                fast + slow, fast, slow, atomic_load(&s->spins),
+                atomic_load(&s->parks), atomic_load(&s->wakeups));
+    }
+    int produced = atomic_load(&G.produced_total);
+    if (produced > 0)
+        fprintf(f, "Backpressure: %.3f producer parks per item (B=%d)\n",
+                (double)atomic_load(&G.empty.parks) / produced, G.B);
+}
+
+static void print_autoscale(FILE *f){
+    if (!G.scale_min) return;
+    long long n = atomic_load(&G.lat_n);
+    fprintf(f, "Autoscale: min=%d  max=%d  peak=%d  grows=%d  shrinks=%d\n",
+            G.scale_min, G.C, G.peak_active, G.grows, G.shrinks);
+    fprintf(f, "Mean occupancy=%.1f%%  mean dequeue latency=%.1f us\n",
+            G.occ_samples ? 100.0 * G.occ_sum / G.occ_samples : 0.0,
+            n ? (double)atomic_load(&G.lat_ns) / n / 1000.0 : 0.0);
+}
+
 // -------------------- One simulation run --------------------
-static int run_simulation(int P, int C, int B, FILE *out, int fast_mode){
+static int run_simulation(int P, int C, int B, FILE *out, const RunOptions *opt){
     // Reset global state
     memset(&G, 0, sizeof(G));
     memset(&GSTATS, 0, sizeof(GSTATS));
-    G.P=P; G.C=C; G.B=B; G.out=out; G.fast_mode=fast_mode;
+    G.P=P; G.C=C; G.B=B; G.out=out; G.fast_mode=opt->fast_mode;
+    G.placement=opt->placement; G.numa_local=opt->numa_local;
+    // Spinning only helps when the other side can run concurrently
+    G.spin_max = opt->spin_max >= 0 ? opt->spin_max : (TOPO.n > 1 ? SPIN_DEFAULT : 0);
+    G.scale_min = opt->scale_min < C ? opt->scale_min : C;
+    atomic_store(&G.active, G.scale_min ? G.scale_min : C);
+    G.peak_active = atomic_load(&G.active);
 
     // Seed once per run for variety
     srand((unsigned)time(NULL) ^ (unsigned)(P*100 + C*10 + B));
 
     // Buffer & sync
     G.capacity = G.B;
-    G.buf = (Sale*)calloc((size_t)G.capacity, sizeof(Sale));
-    if(!G.buf){ perror("calloc buffer"); return 1; }
+    G.prod_cpu = (int*)calloc((size_t)G.P, sizeof(int));
+    G.cons_cpu = (int*)calloc((size_t)G.C, sizeof(int));
+    if(!G.prod_cpu || !G.cons_cpu){ perror("calloc cpu slots"); return 1; }
+    for (int i=0;i<G.P;++i) G.prod_cpu[i] = -1;
+    for (int i=0;i<G.C;++i) G.cons_cpu[i] = -1;
+
+    // With --numa-local, touch the ring from the CPU of the first producer so
+    // it lives on that node rather than wherever main happens to run.
+    int ring_slot = G.numa_local ? placement_slot(0, 0) : -1;
+    cpu_set_t main_set;
+    if (ring_slot >= 0){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(TOPO.cpus[ring_slot].cpu, &set);
+        pthread_getaffinity_np(pthread_self(), sizeof(main_set), &main_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    G.buf = (Slot*)alloc_local((size_t)G.capacity * sizeof(Slot));
+    if (ring_slot >= 0) pthread_setaffinity_np(pthread_self(), sizeof(main_set), &main_set);
+    if(!G.buf){ perror("alloc buffer"); return 1; }
     G.head = G.tail = 0;
+    atomic_store(&G.reserved_total, 0);
     atomic_store(&G.produced_total, 0);
     atomic_store(&G.consumed_total, 0);
-    atomic_store(&G.done, 0);
 
-    if(sem_init(&G.empty,0,(unsigned)G.capacity)!=0){ perror("sem_init empty"); return 1; }
-    if(sem_init(&G.full, 0,0)!=0){ perror("sem_init full"); return 1; }
+    hsem_init(&G.empty, G.capacity);
+    hsem_init(&G.full, 0);
     if(pthread_mutex_init(&G.qmtx,NULL)!=0){ perror("pthread_mutex_init qmtx"); return 1; }
 
     // Global stats
@@ -226,14 +745,13 @@ static int run_simulation(int P, int C, int B, FILE *out, int fast_mode){
     pthread_t *ct = (pthread_t*)calloc((size_t)G.C, sizeof(pthread_t));
     if(!pt || !ct){ perror("calloc threads"); return 1; }
 
-    LocalStats *locals = (LocalStats*)calloc((size_t)G.C, sizeof(LocalStats));
-    if(!locals){ perror("calloc locals"); return 1; }
-    for (int i=0;i<G.C;++i){
-        locals[i].cid=i; locals[i].P=G.P;
-        locals[i].store_totals = (double*)calloc((size_t)G.P, sizeof(double));
-        if(!locals[i].store_totals){ perror("calloc local store_totals"); return 1; }
-        memset(locals[i].month_totals, 0, sizeof(locals[i].month_totals));
-        locals[i].aggregate=0.0;
+    // Per-consumer stats, each on its own pages; left NULL for consumers to
+    // allocate themselves under --numa-local
+    G.locals = (LocalStats**)calloc((size_t)G.C, sizeof(LocalStats*));
+    if(!G.locals){ perror("calloc locals"); return 1; }
+    for (int i=0;i<G.C && !G.numa_local;++i){
+        G.locals[i] = alloc_local_stats(i, G.P);
+        if(!G.locals[i]){ perror("alloc local stats"); return 1; }
     }
 
     // Timing
@@ -242,14 +760,22 @@ static int run_simulation(int P, int C, int B, FILE *out, int fast_mode){
 
     // Create threads
     for(int i=0;i<G.P;++i)
-        if(pthread_create(&pt[i],NULL,producer,(void*)(intptr_t)i)!=0){ perror("pthread_create producer"); return 1; }
+        if(create_placed(&pt[i],0,i,producer)!=0){ perror("pthread_create producer"); return 1; }
     for(int i=0;i<G.C;++i)
-        if(pthread_create(&ct[i],NULL,consumer,&locals[i])!=0){ perror("pthread_create consumer"); return 1; }
+        if(create_placed(&ct[i],1,i,consumer)!=0){ perror("pthread_create consumer"); return 1; }
+    pthread_t st;
+    if(G.scale_min && pthread_create(&st,NULL,scaler,NULL)!=0){ perror("pthread_create scaler"); return 1; }
 
-    // Finish producers, then mark done & wake consumers
+    // Finish producers, stop scaling and release parked consumers, then
+    // close G.full: consumers drain what is left and exit
     for(int i=0;i<G.P;++i) pthread_join(pt[i],NULL);
-    atomic_store(&G.done,1);
-    for(int i=0;i<G.C;++i) sem_post(&G.full); // ensure all waiting consumers wake
+    if (G.scale_min){
+        atomic_store(&G.scale_stop, 1);
+        pthread_join(st, NULL);
+        atomic_store(&G.active, G.C);
+        futex_wake(&G.active, INT_MAX);
+    }
+    hsem_close(&G.full);
 
     // Finish consumers
     for(int i=0;i<G.C;++i) pthread_join(ct[i],NULL);
@@ -266,6 +792,9 @@ static int run_simulation(int P, int C, int B, FILE *out, int fast_mode){
                 atomic_load(&G.produced_total),
                 atomic_load(&G.consumed_total),
                 elapsed_ms);
+        print_placement(out);
+        print_wait_stats(out);
+        print_autoscale(out);
         print_global_tables(out, &GSTATS, G.P);
         fprintf(out, "====================================\n\n");
         fflush(out);
@@ -275,49 +804,108 @@ static int run_simulation(int P, int C, int B, FILE *out, int fast_mode){
                atomic_load(&G.produced_total),
                atomic_load(&G.consumed_total),
                elapsed_ms);
+        print_placement(stdout);
+        print_wait_stats(stdout);
+        print_autoscale(stdout);
         print_global_tables(stdout, &GSTATS, G.P);
     }
 
+    int rc = 0;
+    if (atomic_load(&G.alloc_failed)){
+        fprintf(stderr, "Run P=%d C=%d B=%d: consumer stats allocation failed; totals incomplete\n", P, C, B);
+        rc = 1;
+    }
+
     // Cleanup
-    for(int i=0;i<G.C;++i) free(locals[i].store_totals);
-    free(locals);
+    for(int i=0;i<G.C;++i) free_local_stats(G.locals[i]);
+    free(G.locals);
+    free(G.prod_cpu); free(G.cons_cpu);
     free(pt); free(ct);
     pthread_mutex_destroy(&GSTATS.mtx);
     free(GSTATS.store_totals);
     pthread_mutex_destroy(&G.qmtx);
-    sem_destroy(&G.empty);
-    sem_destroy(&G.full);
-    free(G.buf);
+    free_local(G.buf, (size_t)G.capacity * sizeof(Slot));
 
-    return 0;
+    return rc;
 }
 
 // -------------------- Main --------------------
+// Options shared by single-run and --all mode. Returns 1 if argv[*i] was
+// consumed (advancing *i past any value), 0 if unrecognized, -1 on a bad value.
+static int parse_run_option(int argc, char **argv, int *i, RunOptions *opt){
+    if (strcmp(argv[*i],"--fast")==0){ opt->fast_mode = 1; return 1; }
+    if (strcmp(argv[*i],"--numa-local")==0){ opt->numa_local = 1; return 1; }
+    if (strcmp(argv[*i],"--spin")==0 && *i+1<argc){
+        char *end;
+        long v = strtol(argv[*i+1], &end, 10);
+        if (*end || v < 0 || v > INT_MAX/2){
+            fprintf(stderr, "Invalid spin limit: %s\n", argv[*i+1]);
+            return -1;
+        }
+        opt->spin_max = (int)v;
+        ++*i;
+        return 1;
+    }
+    if (strcmp(argv[*i],"--autoscale")==0 && *i+1<argc){
+        char *end;
+        long v = strtol(argv[*i+1], &end, 10);
+        if (*end || v <= 0 || v > INT_MAX){
+            fprintf(stderr, "Invalid autoscale minimum: %s\n", argv[*i+1]);
+            return -1;
+        }
+        opt->scale_min = (int)v;
+        ++*i;
+        return 1;
+    }
+    if (strcmp(argv[*i],"--placement")==0 && *i+1<argc){
+        if (parse_placement(argv[*i+1], &opt->placement) != 0){
+            fprintf(stderr, "Unknown placement: %s (none|compact|scatter|pair)\n", argv[*i+1]);
+            return -1;
+        }
+        ++*i;
+        return 1;
+    }
+    return 0;
+}
+
+// First-touch placement only means something once threads are pinned.
+static void check_numa_local(RunOptions *opt){
+    if (opt->numa_local && opt->placement == PLACE_NONE){
+        fprintf(stderr, "Warning: --numa-local needs --placement other than none; ignoring it.\n");
+        opt->numa_local = 0;
+    }
+}
+
 int main(int argc, char **argv){
-    int fast_mode = 0;
+    RunOptions opt = { .fast_mode = 0, .placement = PLACE_NONE, .numa_local = 0, .spin_max = -1, .scale_min = 0 };
     const char *outfile = "sample_output.txt";
 
     // Recognize env-based fast mode too
     const char *fm = getenv("FAST_MODE");
-    if (fm && (strcmp(fm,"1")==0 || strcasecmp(fm,"true")==0)) fast_mode = 1;
+    if (fm && (strcmp(fm,"1")==0 || strcasecmp(fm,"true")==0)) opt.fast_mode = 1;
+
+    if (load_topology() != 0) return 1;
 
     if (argc >= 2 && strcmp(argv[1],"--all")==0){
         // Parse optional flags
         for (int i=2;i<argc;++i){
-            if (strcmp(argv[i],"--fast")==0) fast_mode = 1;
-            else if (strcmp(argv[i],"--outfile")==0 && i+1<argc) { outfile = argv[i+1]; ++i; }
+            int r = parse_run_option(argc, argv, &i, &opt);
+            if (r < 0) return 1;
+            if (r > 0) continue;
+            if (strcmp(argv[i],"--outfile")==0 && i+1<argc) { outfile = argv[i+1]; ++i; }
             else {
                 fprintf(stderr, "Unknown option: %s\n", argv[i]);
                 return 1;
             }
         }
+        check_numa_local(&opt);
 
         FILE *out = fopen(outfile, "w");
         if(!out){ perror("fopen sample_output"); return 1; }
 
         fprintf(out, "CS471/571 – Problem 1 (PRODCONS)\n");
         fprintf(out, "All 18 runs (p in {2,5,10}, c in {2,5,10}, b in {3,10})\n");
-        fprintf(out, "Each run produces 1000 items; %s mode.\n\n", fast_mode ? "FAST (no sleeps)" : "SPEC (5–40ms sleeps)");
+        fprintf(out, "Each run produces 1000 items; %s mode.\n\n", opt.fast_mode ? "FAST (no sleeps)" : "SPEC (5–40ms sleeps)");
         fflush(out);
 
         const int Pset[] = {2,5,10};
@@ -325,7 +913,7 @@ int main(int argc, char **argv){
         const int Bset[] = {3,10};
 
         // Console progress
-        printf("Starting 18 runs -> %s (%s)...\n", outfile, fast_mode ? "FAST" : "SPEC");
+        printf("Starting 18 runs -> %s (%s)...\n", outfile, opt.fast_mode ? "FAST" : "SPEC");
         fflush(stdout);
 
         for (int ip=0; ip<3; ++ip){
@@ -337,7 +925,7 @@ int main(int argc, char **argv){
                     printf("Run P=%d C=%d B=%d...\n", P, C, B);
                     fflush(stdout);
 
-                    int rc = run_simulation(P,C,B,out,fast_mode);
+                    int rc = run_simulation(P,C,B,out,&opt);
                     if (rc != 0){
                         fprintf(out, "Run P=%d C=%d B=%d failed (rc=%d)\n\n", P,C,B,rc);
                         fflush(out);
@@ -349,29 +937,43 @@ int main(int argc, char **argv){
         fprintf(out, "\nAll runs complete.\n");
         fclose(out);
         printf("All 18 runs complete. Wrote: %s\n", outfile);
+        free_topology();
         return 0;
     }
 
     // Single-run mode
-    if (!(argc==4 || (argc==5 && strcmp(argv[4],"--fast")==0))){
+    int bad = argc < 4;
+    for (int i=4;i<argc && !bad;++i){
+        int r = parse_run_option(argc, argv, &i, &opt);
+        if (r < 0) return 1;
+        if (r == 0) bad = 1;
+    }
+    if (bad){
         fprintf(stderr,
             "Usage:\n"
-            "  %s <producers> <consumers> <buffer> [--fast]\n"
-            "  %s --all [--fast] [--outfile <path>]\n",
+            "  %s <producers> <consumers> <buffer> [--fast] [--placement <policy>] [--numa-local] [--spin <n>] [--autoscale <min>]\n"
+            "  %s --all [--fast] [--outfile <path>] [--placement <policy>] [--numa-local] [--spin <n>] [--autoscale <min>]\n"
+            "Placement policies: none, compact, scatter, pair\n",
             argv[0], argv[0]);
         return 1;
     }
+    check_numa_local(&opt);
 
     int P = atoi(argv[1]);
     int C = atoi(argv[2]);
     int B = atoi(argv[3]);
-    if (argc==5 && strcmp(argv[4],"--fast")==0) fast_mode = 1;
 
     if (P<=0 || C<=0 || B<=0){
         fprintf(stderr, "All arguments must be positive integers.\n");
         return 1;
     }
+    if (B >= HSEM_CLOSED){
+        fprintf(stderr, "Buffer size must be below %d.\n", HSEM_CLOSED);
+        return 1;
+    }
 
     // Single run -> stdout
-    return run_simulation(P,C,B,/*out*/NULL,fast_mode);
+    int rc = run_simulation(P,C,B,/*out*/NULL,&opt);
+    free_topology();
+    return rc;
 }